@@ -3,18 +3,212 @@
 
 MMA8452Q accel;
 
+// Connections
+// INT1 = D2, freefall and impact interrupts (active LOW)
+const int ACCEL_INT_PIN = 2;
+const byte ACCEL_ADDRESS = 0x1D;
+
+// MMA8452Q registers used by the fall detection
+#define INT_SOURCE 0x0C
+#define FF_MT_CFG 0x15
+#define FF_MT_SRC 0x16
+#define FF_MT_THS 0x17
+#define FF_MT_COUNT 0x18
+#define TRANSIENT_CFG 0x1D
+#define TRANSIENT_SRC 0x1E
+#define TRANSIENT_THS 0x1F
+#define TRANSIENT_COUNT 0x20
+#define CTRL_REG1 0x2A
+#define CTRL_REG4 0x2D
+#define CTRL_REG5 0x2E
+#define SRC_FF_MT 0x04
+#define SRC_TRANS 0x20
+
+// The MMA8452Q supports fast mode I2C
+const unsigned long ACCEL_I2C_CLOCK = 400000;
+
+// Duration of the last accel.read() transaction in microseconds
+unsigned long accelReadMicros = 0;
+
+// Set from the interrupt, the time is taken there so the event is
+// timestamped at the moment the accelerometer flagged it
+volatile boolean fallPending = false;
+volatile unsigned long fallMillis;
+volatile unsigned long fallMicros;
+unsigned long maxFallLatency = 0;  // us from interrupt to the event being sent
+
 void setupAccelerometer()
 {
-  accel.init();
+  // At the default 2 g full scale the 2 g impact threshold below would
+  // only be reached once an axis saturates
+  accel.init(SCALE_8G, ODR_800);
+  resetI2cClock();
+  setupFallDetection();
 }
 
-void getAcceleration(double & x, double & y, double & z)
+void writeAccelRegister(byte reg, byte value)
+{
+  Wire.beginTransmission(ACCEL_ADDRESS);
+  Wire.write(reg);
+  Wire.write(value);
+  Wire.endTransmission();
+}
+
+byte readAccelRegister(byte reg)
+{
+  Wire.beginTransmission(ACCEL_ADDRESS);
+  Wire.write(reg);
+  Wire.endTransmission(false);
+  Wire.requestFrom(ACCEL_ADDRESS, (byte)1);
+  return Wire.read();
+}
+
+// The library does not expose the freefall and transient engines, so
+// they are set up through the registers. At the 800 Hz data rate a
+// debounce count is 1.25 ms, and a threshold count is 0.063 g at any
+// full scale.
+void setupFallDetection()
+{
+  // Registers can only be changed in standby
+  byte ctrl1 = readAccelRegister(CTRL_REG1);
+  writeAccelRegister(CTRL_REG1, ctrl1 & ~0x01);
+
+  // Freefall: all axes below 0.19 g for 80 ms, latched
+  writeAccelRegister(FF_MT_CFG, 0xB8);
+  writeAccelRegister(FF_MT_THS, 3);
+  writeAccelRegister(FF_MT_COUNT, 64);
+
+  // Impact: a high-pass filtered jump of 2 g on any axis for 5 ms, latched
+  writeAccelRegister(TRANSIENT_CFG, 0x1E);
+  writeAccelRegister(TRANSIENT_THS, 32);
+  writeAccelRegister(TRANSIENT_COUNT, 4);
+
+  // Enable both and route them to INT1
+  writeAccelRegister(CTRL_REG4, readAccelRegister(CTRL_REG4) | SRC_FF_MT | SRC_TRANS);
+  writeAccelRegister(CTRL_REG5, readAccelRegister(CTRL_REG5) | SRC_FF_MT | SRC_TRANS);
+
+  writeAccelRegister(CTRL_REG1, ctrl1 | 0x01);
+
+  // init() does not reset the chip, so a source may still be latched from
+  // before a reset. INT1 would then stay low and never give us an edge.
+  readAccelRegister(FF_MT_SRC);
+  readAccelRegister(TRANSIENT_SRC);
+
+  pinMode(ACCEL_INT_PIN, INPUT);
+  attachInterrupt(digitalPinToInterrupt(ACCEL_INT_PIN), onFallInterrupt, FALLING);
+}
+
+void onFallInterrupt()
+{
+  fallMillis = millis();
+  fallMicros = micros();
+  fallPending = true;
+}
+
+// Sends <F,eventTime,latency> for a freefall or <J,eventTime,latency>
+// for an impact. The time is in ms, the latency in us from the interrupt
+// to the moment the event is queued ahead of the bulk data. Reading the source registers
+// also clears the latched interrupt.
+//
+// INT1 stays low while any source is latched, so a source that latched
+// before the interrupt was attached, or while the other one was being
+// read, never produces another falling edge. The pin level is therefore
+// checked as well. One pass reads at most three registers and queues two
+// events, ~0.7 ms; a pin still low afterwards is handled on the next release.
+boolean fallTask()
+{
+  if (!fallPending && digitalRead(ACCEL_INT_PIN) == HIGH)
+  {
+    return false;
+  }
+
+  noInterrupts();
+  unsigned long eventMillis = fallPending ? fallMillis : millis();
+  unsigned long eventMicros = fallPending ? fallMicros : micros();
+  fallPending = false;
+  interrupts();
+
+  setI2cClock(ACCEL_I2C_CLOCK);
+  byte source = readAccelRegister(INT_SOURCE);
+  if (source & SRC_FF_MT)
+  {
+    readAccelRegister(FF_MT_SRC);
+    sendFallEvent('F', eventMillis, eventMicros);
+  }
+  if (source & SRC_TRANS)
+  {
+    readAccelRegister(TRANSIENT_SRC);
+    sendFallEvent('J', eventMillis, eventMicros);
+  }
+  return false;
+}
+
+void sendFallEvent(char type, unsigned long eventMillis, unsigned long eventMicros)
+{
+  unsigned long latency = micros() - eventMicros;
+  if (latency > maxFallLatency)
+  {
+    maxFallLatency = latency;
+  }
+  printUrgentEvent(type, eventMillis, latency);
+}
+
+unsigned long getMaxFallLatency()
+{
+  return maxFallLatency;
+}
+
+// A reading is done as a state machine, one I2C transaction per step
+#define ACCEL_IDLE 0
+#define ACCEL_CHECK 1
+#define ACCEL_READ 2
+
+int accelState = ACCEL_IDLE;
+
+void startAcceleration()
 {
-  if (accel.available())
+  if (accelState == ACCEL_IDLE)
   {
+    accelState = ACCEL_CHECK;
+  }
+}
+
+boolean isAccelerationBusy()
+{
+  return accelState != ACCEL_IDLE;
+}
+
+// Advances the reading by one step, returns true when a new
+// acceleration is available through getAcceleration()
+boolean stepAcceleration()
+{
+  setI2cClock(ACCEL_I2C_CLOCK);
+  if (accelState == ACCEL_CHECK)
+  {
+    // Without new data there is nothing left to do
+    accelState = accel.available() ? ACCEL_READ : ACCEL_IDLE;
+    return false;
+  }
+  if (accelState == ACCEL_READ)
+  {
+    // Reads the raw counts and converts them to g in one burst
+    unsigned long start = micros();
     accel.read();
-    x = accel.cx;
-    y = accel.cy;
-    z = accel.cz;
+    accelReadMicros = micros() - start;
+    accelState = ACCEL_IDLE;
+    return true;
   }
+  return false;
+}
+
+void getAcceleration(double & x, double & y, double & z)
+{
+  x = accel.cx;
+  y = accel.cy;
+  z = accel.cz;
+}
+
+unsigned long getAccelReadMicros()
+{
+  return accelReadMicros;
 }
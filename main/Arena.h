@@ -0,0 +1,51 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+// Memory shared by the heart rate modes.
+//
+// Only one heart rate mode is active at a time, so their buffers are
+// overlaid in a single union instead of each being a separate global.
+// setHeartRateMode() clears the arena before the new mode uses it.
+//
+// Layout (bytes), kept by hand and checked by the asserts below:
+//   offset 0   waveform.batches   2 x PPG_BATCH_SIZE x 2    HEART_RATE_WAVEFORM
+//   offset 0   beats.intervals    BEAT_HISTORY_SIZE x 2     HEART_RATE_BEATS
+//   offset 32  beats.count, next  2                         HEART_RATE_BEATS
+//   HEART_RATE_VALUE does not use the arena.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PPG_BATCH_SIZE 16
+#define BEAT_HISTORY_SIZE 16
+
+// The ATmega328P has 2 KB of SRAM, the arena may take at most this much
+#define HEART_RATE_ARENA_SIZE 64
+
+struct WaveformBuffers {
+  uint16_t batches[2][PPG_BATCH_SIZE];
+};
+
+struct BeatBuffers {
+  uint16_t intervals[BEAT_HISTORY_SIZE];  // ms, oldest overwritten first
+  uint8_t count;
+  uint8_t next;
+};
+
+union HeartRateArena {
+  WaveformBuffers waveform;
+  BeatBuffers beats;
+};
+
+static_assert(sizeof(WaveformBuffers) <= HEART_RATE_ARENA_SIZE, "waveform buffers do not fit the arena");
+static_assert(sizeof(BeatBuffers) <= HEART_RATE_ARENA_SIZE, "beat buffers do not fit the arena");
+static_assert(sizeof(HeartRateArena) <= HEART_RATE_ARENA_SIZE, "heart rate arena does not fit its budget");
+
+static_assert(sizeof(WaveformBuffers::batches) == 2 * PPG_BATCH_SIZE * 2, "layout map: waveform.batches");
+static_assert(sizeof(BeatBuffers::intervals) == BEAT_HISTORY_SIZE * 2, "layout map: beats.intervals");
+static_assert(offsetof(BeatBuffers, count) == 32, "layout map: beats.count");
+static_assert(offsetof(BeatBuffers, next) == offsetof(BeatBuffers, count) + 1, "layout map: beats.next");
+
+extern volatile HeartRateArena heartRateArena;
+
+#endif
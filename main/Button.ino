@@ -17,7 +17,32 @@
 int buttonindex;
  */
 int sensorValue ;
-int KeyTable[31];
+int KeyTable[5];  // one threshold per button, see GenerateKeyTable()
+
+// Buttons in the order of KeyTable
+#define UP_BUTTON       0
+#define DOWN_BUTTON     1
+#define LEFT_BUTTON     2
+#define RIGHT_BUTTON    3
+#define SELECT_BUTTON   4
+#define NO_BUTTON       5
+
+int idleLevel;   // A0 reading with no button pressed
+int idleScaled;  // idleLevel * 16, keeps the fraction of the average
+int lastButton = NO_BUTTON;
+
+// The ladder is scanned this often (ms); polling is the only way the
+// buttons are detected. A pin change interrupt on A0 cannot do it: the
+// buttons pull A0 to 37-62% of VCC, but the digital input buffer is only
+// guaranteed to read low below 30% of VCC. The scan also keeps the idle
+// level tracked so the thresholds follow supply drift and a button held
+// at boot does not spoil them.
+const unsigned long buttonScanPeriod = 100;
+unsigned long lastButtonScan = 0;
+
+// A0 is converted by the heart rate code, which may have to fit it in
+// between two pulse samples, see startLadderReading()
+boolean ladderPending = false;
 /*
 int buttonValue = 1023;
 
@@ -63,7 +88,93 @@ void ButtonSetup(){
 
 void setupButton()
 {
-  GenerateKeyTable(analogRead(A0),KeyTable);
+  // If a button is held now, the first reading after it is released
+  // raises the idle level to where it belongs
+  idleLevel = analogRead(A0);
+  idleScaled = idleLevel * 16;
+  GenerateKeyTable(idleLevel,KeyTable);
+}
+
+// Buttons only pull A0 down, so a reading above the idle level means the
+// idle level itself is higher and is taken over at once. Idle readings
+// below it are averaged in slowly. The key table is only regenerated
+// when the idle level actually changed.
+void trackIdleLevel(int value)
+{
+  if (value * 16 > idleScaled)
+  {
+    idleScaled = value * 16;
+  }
+  else
+  {
+    idleScaled += (value * 16 - idleScaled) / 8;
+  }
+
+  if (idleScaled / 16 != idleLevel)
+  {
+    idleLevel = idleScaled / 16;
+    GenerateKeyTable(idleLevel,KeyTable);
+  }
+}
+
+// The button whose level is nearest to the reading, or NO_BUTTON
+// when the reading is nearest to the idle level
+int classifyButton(int value)
+{
+  int button = NO_BUTTON;
+  int distance = abs(value - idleLevel);
+  for (int i = 0; i < 5; i++)
+  {
+    if (abs(value - KeyTable[i]) < distance)
+    {
+      button = i;
+      distance = abs(value - KeyTable[i]);
+    }
+  }
+  return button;
+}
+
+// Converts A0 once per buttonScanPeriod. Every scan is one conversion,
+// the task stays pending until its result is in.
+boolean buttonTask()
+{
+  if (!ladderPending)
+  {
+    if (millis() - lastButtonScan < buttonScanPeriod)
+    {
+      return false;
+    }
+    lastButtonScan = millis();
+    startLadderReading();
+    ladderPending = true;
+  }
+
+  int value = getLadderReading();
+  if (value < 0)
+  {
+    return true;
+  }
+  ladderPending = false;
+
+  int button = classifyButton(value);
+  if (button == NO_BUTTON)
+  {
+    trackIdleLevel(value);
+  }
+  if (button != lastButton && button != NO_BUTTON)
+  {
+    if (button != SELECT_BUTTON)
+    {
+      showButtonView(button);
+    }
+    else if (!setHeartRateMode((heartRateMode + 1) % NUMBER_OF_HEART_RATE_MODES))
+    {
+      // The change could not be announced, try again on the next scan
+      button = NO_BUTTON;
+    }
+  }
+  lastButton = button;
+  return false;
 }
 
 void GenerateKeyTable(int vcc,int* array)
@@ -0,0 +1,312 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+// Layout of the {...} sample frame.
+//
+// The firmware encoder (sendFrameStep() in SerialController.ino) builds
+// frames with the functions below, and host decoders parse them with
+// decode<>(), so they cannot drift apart. It is plain C++11 without
+// Arduino headers, so a host program can include it as is.
+//
+// A frame is startChar, every value followed by separatorChar, then
+// endChar, e.g. {23.50,0.01,-0.02,1.00,512.00,}
+// The heart rate is left out when it is sent as events instead, the
+// <M,mode,valuesPerFrame> event tells the host which frames follow.
+
+namespace frame {
+
+const char startChar = '{';
+const char separatorChar = ',';
+const char endChar = '}';
+
+// Channels in frame order
+enum Channel { TEMPERATURE, ACCEL_X, ACCEL_Y, ACCEL_Z, HEART_RATE };
+
+// Number of decimals of every channel, in frame order
+template <unsigned char First, unsigned char... Rest>
+struct Schema {
+  static constexpr int channels = 1 + sizeof...(Rest);
+  static constexpr unsigned char decimals(int channel) {
+    return channel == 0 ? First : Schema<Rest...>::decimals(channel - 1);
+  }
+};
+
+template <unsigned char Last>
+struct Schema<Last> {
+  static constexpr int channels = 1;
+  static constexpr unsigned char decimals(int) {
+    return Last;
+  }
+};
+
+// Every value has 2 decimals
+typedef Schema<2, 2, 2, 2, 2> SampleFrame;
+
+static_assert(SampleFrame::channels == HEART_RATE + 1, "every channel needs a schema entry");
+
+// Number of values in a frame. The heart rate is the last channel, so
+// leaving it out just ends the frame one value earlier.
+template <typename S>
+constexpr int valuesPerFrame(bool withHeartRate) {
+  return withHeartRate ? S::channels : S::channels - 1;
+}
+
+constexpr long powerOfTen(unsigned char exponent) {
+  return exponent == 0 ? 1 : 10 * powerOfTen(exponent - 1);
+}
+
+// Encoding and decoding are written as C++11 constexpr functions, so the
+// example frame at the end of this file is encoded and decoded by the
+// compiler every time this header is built, on the board and on the host.
+
+// --- Encoding ---
+//
+// A value is sent as a fixed point number, value * 10^decimals rounded to
+// a long. A field is that number followed by separatorChar. Characters
+// are computed by position, which is what lets the compiler check them.
+
+constexpr long toFixed(double value, unsigned char decimals) {
+  return value < 0 ? -toFixed(-value, decimals) : (long)(value * powerOfTen(decimals) + 0.5);
+}
+
+// Digits of magnitude, compared against powers of ten so that no divide is needed
+constexpr int digitCount(long magnitude, unsigned char digits = 1) {
+  return magnitude < powerOfTen(digits) ? digits : digits == 9 ? 10 : digitCount(magnitude, digits + 1);
+}
+
+// Digits printed for magnitude, at least one before the decimal point
+constexpr int fixedDigits(long magnitude, unsigned char decimals) {
+  return digitCount(magnitude) > decimals ? digitCount(magnitude) : decimals + 1;
+}
+
+// Characters of the field, the separator included
+constexpr int fieldLength(long fixed, unsigned char decimals) {
+  return (fixed < 0 ? 1 : 0) + fixedDigits(fixed < 0 ? -fixed : fixed, decimals) + (decimals > 0 ? 1 : 0) + 1;
+}
+
+// Digit number digit of magnitude, counted from the left of digits digits
+constexpr char digitChar(long magnitude, int digits, int digit) {
+  return '0' + (magnitude / powerOfTen(digits - 1 - digit)) % 10;
+}
+
+// Character i of the unsigned number of length characters
+constexpr char numberChar(long magnitude, unsigned char decimals, int i, int length) {
+  return decimals > 0 && i == length - 1 - decimals ? '.'
+       : digitChar(magnitude, decimals > 0 ? length - 1 : length,
+                   decimals > 0 && i > length - 1 - decimals ? i - 1 : i);
+}
+
+// Character i of a field of length characters, see fieldLength()
+constexpr char fieldChar(long fixed, unsigned char decimals, int i, int length) {
+  return i == length - 1 ? separatorChar
+       : fixed < 0 ? (i == 0 ? '-' : numberChar(-fixed, decimals, i - 1, length - 2))
+       : numberChar(fixed, decimals, i, length - 1);
+}
+
+template <typename S>
+constexpr char charInField(const long * fixed, int count, int i, int channel, int start, int length);
+
+// Character i of a frame of count values, when the field of channel
+// starts at start. Past the last field comes endChar.
+template <typename S>
+constexpr char charFrom(const long * fixed, int count, int i, int channel, int start) {
+  return channel == count ? endChar
+       : charInField<S>(fixed, count, i, channel, start, fieldLength(fixed[channel], S::decimals(channel)));
+}
+
+template <typename S>
+constexpr char charInField(const long * fixed, int count, int i, int channel, int start, int length) {
+  return i < start + length ? fieldChar(fixed[channel], S::decimals(channel), i - start, length)
+       : charFrom<S>(fixed, count, i, channel + 1, start + length);
+}
+
+// Character i of the frame of the count values in fixed
+template <typename S>
+constexpr char frameChar(const long * fixed, int count, int i) {
+  return i == 0 ? startChar : charFrom<S>(fixed, count, i, 0, 1);
+}
+
+template <typename S>
+constexpr int encodedLength(const long * fixed, int count, int channel = 0, int start = 1) {
+  return channel == count ? start + 1
+       : encodedLength<S>(fixed, count, channel + 1, start + fieldLength(fixed[channel], S::decimals(channel)));
+}
+
+// The firmware builds a frame one field per step with these. They write
+// exactly the characters of frameChar(): start with encodeStart(), add
+// every field with encodeField() at the position the previous call
+// returned, then close it with encodeEnd().
+template <typename S>
+int encodeStart(char * text, const long * fixed, int count) {
+  text[0] = frameChar<S>(fixed, count, 0);
+  return 1;
+}
+
+template <typename S>
+int encodeField(char * text, const long * fixed, int count, int channel, int start) {
+  int length = fieldLength(fixed[channel], S::decimals(channel));
+  for (int i = start; i < start + length; i++) {
+    text[i] = charInField<S>(fixed, count, i, channel, start, length);
+  }
+  return start + length;
+}
+
+template <typename S>
+int encodeEnd(char * text, const long * fixed, int count, int start) {
+  text[start] = charFrom<S>(fixed, count, start, count, start);
+  return start + 1;
+}
+
+// --- Decoding ---
+//
+// Positions are -1 once the text stopped matching the layout.
+
+constexpr bool isDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+// Position of the first non digit at or after i
+constexpr int skipDigits(const char * text, int length, int i) {
+  return i < length && isDigit(text[i]) ? skipDigits(text, length, i + 1) : i;
+}
+
+// Value of the digits from i up to end
+constexpr long digitsValue(const char * text, int i, int end, long value = 0) {
+  return i == end ? value : digitsValue(text, i + 1, end, value * 10 + (text[i] - '0'));
+}
+
+// Position past an optional minus sign at i
+constexpr int signEnd(const char * text, int length, int i) {
+  return i < length && text[i] == '-' ? i + 1 : i;
+}
+
+// Position past a '.' at i followed by exactly decimals digits
+constexpr int fractionEnd(const char * text, int length, int i, unsigned char decimals) {
+  return decimals == 0 ? i
+       : i < length && text[i] == '.' && skipDigits(text, length, i + 1) == i + 1 + decimals ? i + 1 + decimals
+       : -1;
+}
+
+// Position past the whole digits from start to end and the fraction,
+// there must be at least one whole digit
+constexpr int wholeEnd(const char * text, int length, int start, int end, unsigned char decimals) {
+  return end == start ? -1 : fractionEnd(text, length, end, decimals);
+}
+
+// Position past the number whose digits start at i
+constexpr int digitsEnd(const char * text, int length, int i, unsigned char decimals) {
+  return wholeEnd(text, length, i, skipDigits(text, length, i), decimals);
+}
+
+// Position past the separator at i
+constexpr int separatorEnd(const char * text, int length, int i) {
+  return i >= 0 && i < length && text[i] == separatorChar ? i + 1 : -1;
+}
+
+// Position past the field at i
+constexpr int fieldEnd(const char * text, int length, int i, unsigned char decimals) {
+  return i < 0 ? -1 : separatorEnd(text, length, digitsEnd(text, length, signEnd(text, length, i), decimals));
+}
+
+// Value of the digits at i, whose whole part ends at end
+constexpr double unsignedValue(const char * text, int i, int end, unsigned char decimals) {
+  return digitsValue(text, i, end)
+       + (decimals == 0 ? 0.0 : (double)digitsValue(text, end + 1, end + 1 + decimals) / powerOfTen(decimals));
+}
+
+// Value of the well formed field at i
+constexpr double fieldValue(const char * text, int length, int i, unsigned char decimals) {
+  return text[i] == '-' ? -fieldValue(text, length, i + 1, decimals)
+       : unsignedValue(text, i, skipDigits(text, length, i), decimals);
+}
+
+// Position past the endChar at i, or 0
+constexpr int frameEnd(const char * text, int length, int i) {
+  return i >= 0 && i < length && text[i] == endChar ? i + 1 : 0;
+}
+
+// Position of the field of channel in the frame at the start of text.
+// Walks the frame from its start, fine for the checks below; decode()
+// goes through the frame once instead.
+template <typename S>
+constexpr int fieldStart(const char * text, int length, int channel) {
+  return channel == 0 ? (length > 0 && text[0] == startChar ? 1 : -1)
+       : fieldEnd(text, length, fieldStart<S>(text, length, channel - 1), S::decimals(channel - 1));
+}
+
+// Number of characters of the frame at the start of text, or 0 when
+// text does not start with a complete, well formed frame. count is the
+// number of values in the frame, see valuesPerFrame().
+template <typename S>
+constexpr int frameLength(const char * text, int length, int count = S::channels) {
+  return frameEnd(text, length, fieldStart<S>(text, length, count));
+}
+
+// Value of channel in a frame frameLength() accepted
+template <typename S>
+constexpr double valueOf(const char * text, int length, int channel) {
+  return fieldValue(text, length, fieldStart<S>(text, length, channel), S::decimals(channel));
+}
+
+// Decodes the frame at the start of text into values in one pass.
+// Returns the number of characters used, or 0 when text does not start
+// with a complete, well formed frame.
+template <typename S>
+int decode(const char * text, int length, double * values, int count = S::channels) {
+  if (length < 1 || text[0] != startChar) {
+    return 0;
+  }
+
+  int i = 1;
+  for (int channel = 0; channel < count; channel++) {
+    int end = fieldEnd(text, length, i, S::decimals(channel));
+    if (end < 0) {
+      return 0;
+    }
+    values[channel] = fieldValue(text, length, i, S::decimals(channel));
+    i = end;
+  }
+  return frameEnd(text, length, i);
+}
+
+// --- Checks ---
+
+// True if the frame the encoder builds from fixed is exactly text
+template <typename S>
+constexpr bool encodesAs(const long * fixed, int count, const char * text, int length, int i = 0) {
+  return i == length ? encodedLength<S>(fixed, count) == length
+       : frameChar<S>(fixed, count, i) == text[i] && encodesAs<S>(fixed, count, text, length, i + 1);
+}
+
+constexpr long exampleValues[] = {
+  toFixed(23.5, SampleFrame::decimals(TEMPERATURE)),
+  toFixed(0.01, SampleFrame::decimals(ACCEL_X)),
+  toFixed(-0.02, SampleFrame::decimals(ACCEL_Y)),
+  toFixed(1.0, SampleFrame::decimals(ACCEL_Z)),
+  toFixed(512.0, SampleFrame::decimals(HEART_RATE)),
+};
+constexpr char exampleFrame[] = "{23.50,0.01,-0.02,1.00,512.00,}";
+constexpr char exampleFrameWithoutHeartRate[] = "{23.50,0.01,-0.02,1.00,}";
+constexpr int exampleLength = sizeof(exampleFrame) - 1;
+constexpr int exampleLengthWithoutHeartRate = sizeof(exampleFrameWithoutHeartRate) - 1;
+
+static_assert(encodesAs<SampleFrame>(exampleValues, valuesPerFrame<SampleFrame>(true),
+                                     exampleFrame, exampleLength), "encoder does not build the example frame");
+static_assert(encodesAs<SampleFrame>(exampleValues, valuesPerFrame<SampleFrame>(false),
+                                     exampleFrameWithoutHeartRate, exampleLengthWithoutHeartRate),
+              "encoder does not leave out the heart rate");
+
+static_assert(frameLength<SampleFrame>(exampleFrame, exampleLength) == exampleLength, "example frame does not decode");
+static_assert(valueOf<SampleFrame>(exampleFrame, exampleLength, TEMPERATURE) == 23.5, "example temperature");
+static_assert(valueOf<SampleFrame>(exampleFrame, exampleLength, ACCEL_Y) == -0.02, "example negative value");
+static_assert(valueOf<SampleFrame>(exampleFrame, exampleLength, HEART_RATE) == 512, "example heart rate");
+static_assert(frameLength<SampleFrame>(exampleFrameWithoutHeartRate, exampleLengthWithoutHeartRate,
+                                       valuesPerFrame<SampleFrame>(false)) == exampleLengthWithoutHeartRate,
+              "frame without heart rate does not decode");
+static_assert(frameLength<SampleFrame>(exampleFrameWithoutHeartRate, exampleLengthWithoutHeartRate) == 0,
+              "a short frame must not decode as a full one");
+static_assert(frameLength<SampleFrame>(exampleFrame, exampleLength - 1) == 0, "a cut off frame must not decode");
+
+}
+
+#endif
@@ -1,9 +1,91 @@
 //Video link:  https://www.youtube.com/watch?v=82T_zBZQkOE
+#include <util/atomic.h>
+
 int PulseSensor = A1;
 
+// Leading edge of a beat is detected above UpperThreshold,
+// the trailing edge below LowerThreshold.
+const int UpperThreshold = 518;
+const int LowerThreshold = 490;
+
+boolean ignoreReading = false;
+boolean firstPulseDetected = false;
+unsigned long lastBeatTime = 0;
+unsigned long beatInterval = 0;
+
+// Raw waveform streaming (HEART_RATE_WAVEFORM).
+// Timer1 compare match B starts a conversion of A1 at ppgSampleRate and
+// the ADC interrupt picks up the result, so nothing waits for the ADC.
+// Every ppgDecimation readings are summed into one output sample, a boxcar
+// filter that also acts as the anti-alias filter for the lower rate.
+// At 100 Hz with 16-bit samples the batches take about 480 bytes/s,
+// well inside the ~11500 bytes/s of the 115200 baud link.
+const unsigned int ppgSampleRate = 400; // Hz
+const byte ppgDecimation = 4;           // 100 Hz output rate
+const byte ppgSampleBits = 16;          // 16: sum of the readings, 8: top 8 bits of their average
+
+// The batches live in heartRateArena.waveform
+volatile byte ppgFillBatch = 0;
+volatile byte ppgFillCount = 0;
+volatile boolean ppgBatchReady = false;
+volatile unsigned long ppgReadyIndex = 0;  // index of the first sample in the ready batch
+volatile unsigned long ppgSampleIndex = 0; // index of the next output sample
+volatile unsigned int ppgOverruns = 0;     // batches dropped because the last one was not sent yet
+volatile unsigned int ppgLastSample = 0;
+unsigned int ppgAccumulator = 0;
+byte ppgAccumulated = 0;
+
+// While the waveform is sampled the ADC belongs to its interrupt, other
+// A0 conversions are squeezed in between two pulse samples.
+volatile boolean ladderRequested = false;
+volatile boolean ladderConverting = false;
+volatile int ladderValue = -1;
+
+volatile HeartRateArena heartRateArena;
+
 void setupHeartRate()
 {
   pinMode(PulseSensor, INPUT);
+  setHeartRateMode(heartRateMode);
+}
+
+// Switches the heart rate output and hands the arena to the new mode.
+// The switch is announced as <M,mode,valuesPerFrame> so the host knows
+// how many values the following frames have. Returns false, leaving the
+// mode as it is, when the bulk lane has no room for the announcement.
+boolean setHeartRateMode(int mode) {
+  int values = frame::valuesPerFrame<frame::SampleFrame>(mode == HEART_RATE_VALUE);
+  if (!printEventIfRoom('M', mode, values)) {
+    return false;
+  }
+
+  stopPpgSampling();
+
+  // Whatever the previous mode left in the arena is meaningless now
+  for (size_t i = 0; i < sizeof(heartRateArena); i++) {
+    ((volatile byte *)&heartRateArena)[i] = 0;
+  }
+
+  // The same goes for the beat statistics and heart rate readings of the old mode
+  resetBeatVariability();
+  clearSamples(HEART_RATE_CHANNEL);
+
+  ignoreReading = false;
+  firstPulseDetected = false;
+  beatInterval = 0;
+
+  ppgFillBatch = 0;
+  ppgFillCount = 0;
+  ppgBatchReady = false;
+  ppgSampleIndex = 0;
+  ppgAccumulator = 0;
+  ppgAccumulated = 0;
+
+  heartRateMode = mode;
+  if (heartRateMode == HEART_RATE_WAVEFORM) {
+    startPpgSampling();
+  }
+  return true;
 }
 
 double getHeartRate() {
@@ -11,54 +93,181 @@ double getHeartRate() {
 
   return heartRate;
 }
-/*
-    int UpperThreshold = 518;
-    int LowerThreshold = 490;
-    int reading = A1;
-    float BPM = 0.0;
-    bool IgnoreReading = false;
-    bool FirstPulseDetected = false;
-    unsigned long FirstPulseTime = 0;
-    unsigned long SecondPulseTime = 0;
-    unsigned long PulseInterval = 0;
-
-    void setupHeartRate(){
-      Serial.begin(115200);
+
+// Samples the pulse sensor once and returns true when a new beat was
+// detected. The beat is only reported once we know its interval.
+boolean detectBeat() {
+  int reading = analogRead(PulseSensor);
+  unsigned long now = millis();
+  boolean beat = false;
+
+  // Heart beat leading edge detected.
+  if (reading > UpperThreshold && !ignoreReading) {
+    if (firstPulseDetected) {
+      beatInterval = now - lastBeatTime;
+      beat = true;
     }
+    firstPulseDetected = true;
+    lastBeatTime = now;
+    ignoreReading = true;
+  }
+
+  // Heart beat trailing edge detected.
+  if (reading < LowerThreshold) {
+    ignoreReading = false;
+  }
+
+  return beat;
+}
+
+unsigned long getBeatTime() {
+  return lastBeatTime;
+}
+
+// Inter-beat interval in milliseconds
+unsigned long getBeatInterval() {
+  return beatInterval;
+}
+
+double getBeatsPerMinute() {
+  if (beatInterval == 0) {
+    return 0;
+  }
+  return 60000.0 / beatInterval;
+}
 
-    void loop(){
-
-      reading = analogRead(0); 
-
-      // Heart beat leading edge detected.
-      if(reading > UpperThreshold && IgnoreReading == false){
-        if(FirstPulseDetected == false){
-          FirstPulseTime = millis();
-          FirstPulseDetected = true;
-        }
-        else{
-          SecondPulseTime = millis();
-          PulseInterval = SecondPulseTime - FirstPulseTime;
-          FirstPulseTime = SecondPulseTime;
-        }
-        IgnoreReading = true;
-      }
-
-      // Heart beat trailing edge detected.
-      if(reading < LowerThreshold){
-        IgnoreReading = false;
-      }  
-
-      BPM = (1.0/PulseInterval) * 60.0 * 1000;
-      Serial.print(reading);
-      Serial.print("\t");
-      Serial.print(PulseInterval);
-      Serial.print("\t");
-      Serial.print(BPM);
-      Serial.println(" BPM");
-      Serial.flush();
-
-      // Please don't use delay() - this is just for testing purposes.
-      delay(50);  
+void startPpgSampling() {
+  noInterrupts();
+  TCCR1A = 0;
+  TCCR1B = _BV(WGM12) | _BV(CS11);  // CTC mode, clk/8
+  OCR1A = F_CPU / 8 / ppgSampleRate - 1;
+  OCR1B = OCR1A;                    // compare B hits once per period too
+  TCNT1 = 0;
+  TIMSK1 = 0;
+  TIFR1 = _BV(OCF1B);
+
+  ADMUX = _BV(REFS0) | (PulseSensor - A0);  // AVcc reference, as analogRead()
+  ADCSRB = _BV(ADTS2) | _BV(ADTS0);         // auto trigger on Timer1 compare B
+  ADCSRA |= _BV(ADATE) | _BV(ADIE);
+  interrupts();
+}
+
+void stopPpgSampling() {
+  ADCSRA &= ~(_BV(ADATE) | _BV(ADIE));
+  TCCR1B = 0;
+  // Let a running conversion finish before analogRead() takes over
+  while (ADCSRA & _BV(ADSC));
+  ladderRequested = false;
+  ladderConverting = false;
+}
+
+ISR(ADC_vect) {
+  int reading = ADC;
+
+  if (ladderConverting) {
+    // The A0 conversion started below, go back to the pulse sensor
+    ladderValue = reading;
+    ladderConverting = false;
+    ADMUX = _BV(REFS0) | (PulseSensor - A0);
+    return;
+  }
+
+  // The next compare B match only starts a conversion once its flag is cleared
+  TIFR1 = _BV(OCF1B);
+
+  if (ladderRequested) {
+    // One conversion takes ~112 us, far less than the 2.5 ms to the next sample
+    ladderRequested = false;
+    ladderConverting = true;
+    ADMUX = _BV(REFS0);  // channel 0, A0
+    ADCSRA |= _BV(ADSC);
+  }
+
+  ppgAccumulator += reading;
+  if (++ppgAccumulated < ppgDecimation) {
+    return;
+  }
+
+  unsigned int sample = ppgAccumulator;
+  if (ppgSampleBits == 8) {
+    sample = (ppgAccumulator / ppgDecimation) >> 2;
+  }
+  ppgLastSample = ppgAccumulator / ppgDecimation;
+  ppgAccumulator = 0;
+  ppgAccumulated = 0;
+
+  heartRateArena.waveform.batches[ppgFillBatch][ppgFillCount++] = sample;
+  ppgSampleIndex++;
+  if (ppgFillCount < PPG_BATCH_SIZE) {
+    return;
+  }
+
+  ppgFillCount = 0;
+  if (ppgBatchReady) {
+    // The previous batch is still waiting, drop this one and refill it.
+    // The host sees the gap in the sample index.
+    ppgOverruns++;
+    return;
+  }
+  ppgReadyIndex = ppgSampleIndex - PPG_BATCH_SIZE;
+  ppgFillBatch = 1 - ppgFillBatch;
+  ppgBatchReady = true;
+}
+
+// Sends the last completed batch as <P,firstSampleIndex,hexSamples>
+void sendPpgBatch() {
+  if (!ppgBatchReady) {
+    return;
+  }
+
+  // The interrupt only writes the other batch until ppgBatchReady is cleared
+  unsigned int batch[PPG_BATCH_SIZE];
+  volatile uint16_t * ready = heartRateArena.waveform.batches[1 - ppgFillBatch];
+  for (int i = 0; i < PPG_BATCH_SIZE; i++) {
+    batch[i] = ready[i];
+  }
+  unsigned long firstIndex = ppgReadyIndex;
+  ppgBatchReady = false;
+
+  printSampleBatch(firstIndex, batch, PPG_BATCH_SIZE, ppgSampleBits / 4);
+}
+
+unsigned int getPpgOverruns() {
+  unsigned int overruns;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    overruns = ppgOverruns;
+  }
+  return overruns;
+}
+
+// Average of the last decimated readings, in analogRead() units
+double getPpgSample() {
+  unsigned int sample;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    sample = ppgLastSample;
+  }
+  return sample;
+}
+
+// Starts a conversion of the button ladder on A0. Without the waveform
+// sampling the ADC is free and getLadderReading() converts right away.
+void startLadderReading() {
+  if (heartRateMode == HEART_RATE_WAVEFORM) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      ladderValue = -1;
+      ladderRequested = true;
     }
-      */
+  }
+}
+
+// The A0 reading asked for by startLadderReading(), -1 until it is done
+int getLadderReading() {
+  if (heartRateMode != HEART_RATE_WAVEFORM) {
+    return analogRead(A0);
+  }
+  int value;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    value = ladderValue;
+  }
+  return value;
+}
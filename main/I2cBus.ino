@@ -0,0 +1,23 @@
+#include <Wire.h> // Must include Wire library for I2C
+
+// Wire.begin() always leaves the bus at the 100 kHz standard mode clock
+const unsigned long I2C_DEFAULT_CLOCK = 100000;
+
+unsigned long i2cClock = I2C_DEFAULT_CLOCK;
+
+// Call after a sensor library has (re)started the bus with Wire.begin()
+void resetI2cClock()
+{
+  i2cClock = I2C_DEFAULT_CLOCK;
+}
+
+// Switch the bus to the clock of the device we are about to talk to.
+// Only touches the TWI registers when the clock actually differs.
+void setI2cClock(unsigned long clock)
+{
+  if (clock != i2cClock)
+  {
+    Wire.setClock(clock);
+    i2cClock = clock;
+  }
+}
@@ -1,76 +1,141 @@
 #include <LiquidCrystal.h>
 LiquidCrystal lcd(8, 9, 4, 5, 6, 7);
 
+// The views are composed into lcdLines, a copy of the display contents.
+// updateLcdStep() then sends it to the display LCD_CHUNK characters per step.
+// Every byte, the setCursor() command included, takes ~0.3 ms through
+// LiquidCrystal, so a step of two characters stays within its 1 ms budget.
+#define LCD_CHUNK 2
+
+#define LCD_OVERVIEW 0
+#define LCD_HEART_RATE 1
+#define LCD_TEMPERATURE 2
+#define LCD_ACCELERATION 3
+
+int lcdView = LCD_OVERVIEW;
+char lcdLines[2][16];
+int lcdStep = 0;
+
 void setupLcd()
 {
   lcd.begin(16, 2);
   lcd.clear();
+  memset(lcdLines, ' ', sizeof(lcdLines));
+}
+
+// Picks the view like the navigation of the old showMain() screen
+void showButtonView(int button)
+{
+  if (button == LEFT_BUTTON) {
+    lcdView = LCD_HEART_RATE;
+  } else if (button == RIGHT_BUTTON) {
+    lcdView = LCD_TEMPERATURE;
+  } else if (button == UP_BUTTON) {
+    lcdView = LCD_ACCELERATION;
+  } else if (button == DOWN_BUTTON) {
+    lcdView = LCD_OVERVIEW;
+  }
+}
+
+// Writes text like lcd.print() would from the given position and
+// returns the column after it. Text past the end of the line is lost.
+int lcdPut(int row, int column, const char * text)
+{
+  while (*text && column < 16) {
+    lcdLines[row][column++] = *text++;
+  }
+  return column;
+}
+
+int lcdPut(int row, int column, double value)
+{
+  char text[12];
+  dtostrf(value, 1, 2, text);
+  return lcdPut(row, column, text);
+}
+
+boolean updateLcdStep()
+{
+  if (lcdStep == 0) {
+    unsigned long frameTime;
+    double values[NUMBER_OF_CHANNELS];
+    readSnapshot(frameTime, values);
+    if (lcdView == LCD_HEART_RATE) {
+      showHeartRate(values[HEART_RATE_CHANNEL]);
+    } else if (lcdView == LCD_TEMPERATURE) {
+      showTemperature(values[TEMPERATURE_CHANNEL]);
+    } else if (lcdView == LCD_ACCELERATION) {
+      showAcceleration(values[ACCEL_X_CHANNEL], values[ACCEL_Y_CHANNEL], values[ACCEL_Z_CHANNEL]);
+    } else {
+      LcdOnScreen(values[TEMPERATURE_CHANNEL], values[ACCEL_X_CHANNEL], values[ACCEL_Y_CHANNEL],
+                  values[ACCEL_Z_CHANNEL], values[HEART_RATE_CHANNEL]);
+    }
+    lcdStep++;
+    return true;
+  }
+
+  int row = (lcdStep - 1) / (16 / LCD_CHUNK);
+  int column = ((lcdStep - 1) % (16 / LCD_CHUNK)) * LCD_CHUNK;
+  lcd.setCursor(column, row);
+  for (int i = 0; i < LCD_CHUNK; i++) {
+    lcd.print(lcdLines[row][column + i]);
+  }
+
+  if (++lcdStep > 2 * (16 / LCD_CHUNK)) {
+    lcdStep = 0;
+    return false;
+  }
+  return true;
 }
 
 void LcdOnScreen(double temperature, double x, double y, double z, double heartRate){
-  //lcd.clear();
-  lcd.setCursor(1,0);
-  lcd.print("HR:");
-  lcd.print(heartRate);
-  lcd.setCursor(7,0);
-  lcd.print("    ");
-  lcd.setCursor(10,0);
-  lcd.print("X");
-  lcd.print(x);
-  lcd.setCursor(15,0);
-  lcd.print(" ");
-  lcd.setCursor(0,1);
-  lcd.print("T:");
-  lcd.print(temperature);
-  lcd.setCursor(4,1);
-  lcd.print(" ");
-  lcd.setCursor(5,1);
-  lcd.print("Y");
-  lcd.print(y);
-  lcd.setCursor(10,1);
-  lcd.print(" ");
-  lcd.setCursor(11,1);
-  lcd.print("Z");
-  lcd.print(z);
+  int column;
+  column = lcdPut(0, 1, "HR:");
+  lcdPut(0, column, heartRate);
+  lcdPut(0, 7, "    ");
+  column = lcdPut(0, 10, "X");
+  lcdPut(0, column, x);
+  lcdPut(0, 15, " ");
+  column = lcdPut(1, 0, "T:");
+  lcdPut(1, column, temperature);
+  lcdPut(1, 4, " ");
+  column = lcdPut(1, 5, "Y");
+  lcdPut(1, column, y);
+  lcdPut(1, 10, " ");
+  column = lcdPut(1, 11, "Z");
+  lcdPut(1, column, z);
 }
 
 void showHeartRate(double heartRate)
 { 
-  //lcd.clear();
-  lcd.setCursor(0,0);
-  lcd.print("Heart Rate:");
-  lcd.print(heartRate);
-  lcd.setCursor(0,1);
-  lcd.print("                ");
+  int column;
+  column = lcdPut(0, 0, "Heart Rate:");
+  lcdPut(0, column, heartRate);
+  lcdPut(1, 0, "                ");
 }
 
 
 void showAcceleration(double x, double y, double z)
 { 
-  //lcd.clear();
-  lcd.setCursor(0,0);
-  lcd.print("X:");
-  lcd.print(x);
-  lcd.print(" ");
-  lcd.setCursor(8,0);
-  lcd.print("Y:");
-  lcd.print(y);
-  lcd.setCursor(0,1);
-  lcd.print("Z:");
-  lcd.print(z);
-  lcd.print("         ");
+  int column;
+  column = lcdPut(0, 0, "X:");
+  column = lcdPut(0, column, x);
+  lcdPut(0, column, " ");
+  column = lcdPut(0, 8, "Y:");
+  lcdPut(0, column, y);
+  column = lcdPut(1, 0, "Z:");
+  column = lcdPut(1, column, z);
+  lcdPut(1, column, "         ");
 }
 
 
 void showTemperature(double temperature)
 { 
-  //lcd.clear();
-  lcd.setCursor(0,0);
-  lcd.print("Temp:");
-  lcd.print(temperature);
-  lcd.print(" C   ");
-  lcd.setCursor(0,1);
-  lcd.print("                ");
+  int column;
+  column = lcdPut(0, 0, "Temp:");
+  column = lcdPut(0, column, temperature);
+  lcdPut(0, column, " C   ");
+  lcdPut(1, 0, "                ");
 }
 
 /*
@@ -0,0 +1,49 @@
+// The channels are read one after the other within loop(), a few
+// milliseconds apart. Every channel keeps its last two timestamped
+// readings and frames are built by interpolating all of them to the
+// same grid time, so the values in a frame belong to one instant.
+//
+// The grid time of a frame lies between the previous and the current
+// reading of every channel, so the added latency is bounded by the time
+// it takes to read all sensors once.
+unsigned long sampleTimes[NUMBER_OF_CHANNELS][2];
+double sampleValues[NUMBER_OF_CHANNELS][2];
+byte sampleCounts[NUMBER_OF_CHANNELS];
+
+void addSample(int channel, unsigned long time, double value) {
+  sampleTimes[channel][0] = sampleTimes[channel][1];
+  sampleValues[channel][0] = sampleValues[channel][1];
+  sampleTimes[channel][1] = time;
+  sampleValues[channel][1] = value;
+  if (sampleCounts[channel] < 2) {
+    sampleCounts[channel]++;
+  }
+}
+
+// Forgets the readings of channel, e.g. when their source changes
+void clearSamples(int channel) {
+  sampleCounts[channel] = 0;
+}
+
+double resample(int channel, unsigned long time) {
+  if (sampleCounts[channel] == 0) {
+    return 0;
+  }
+  if (sampleCounts[channel] == 1) {
+    return sampleValues[channel][1];
+  }
+
+  unsigned long t0 = sampleTimes[channel][0];
+  unsigned long t1 = sampleTimes[channel][1];
+  double v0 = sampleValues[channel][0];
+  double v1 = sampleValues[channel][1];
+
+  // Hold the nearest reading outside the interval, never extrapolate
+  if ((long)(time - t0) <= 0) {
+    return v0;
+  }
+  if ((long)(time - t1) >= 0) {
+    return v1;
+  }
+  return v0 + (v1 - v0) * (time - t0) / (t1 - t0);
+}
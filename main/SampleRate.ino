@@ -0,0 +1,127 @@
+// Adaptive sampling: at rest the channels are sampled slowly, when the
+// accelerometer sees movement or the beat intervals start to vary they
+// are sampled faster. Every change is announced as <R,channel,periodMs>
+// so the host knows the spacing of the following samples.
+
+// Sampling period bounds per channel in milliseconds
+const unsigned long minSamplePeriods[NUMBER_OF_CHANNELS] = {1000, 100, 100, 100, 100};
+const unsigned long maxSamplePeriods[NUMBER_OF_CHANNELS] = {4000, 1000, 1000, 1000, 1000};
+unsigned long samplePeriods[NUMBER_OF_CHANNELS];
+unsigned long lastSampleTimes[NUMBER_OF_CHANNELS];
+
+// Deviation of |a| from 1 g above which we treat the wearer as moving,
+// and below which as resting
+const double activeThreshold = 0.10;
+const double restThreshold = 0.03;
+// RMSSD of the recent beat intervals (ms) above which
+// the heart rate is considered to be changing
+const double variabilityThreshold = 50;
+
+// Exponential moving average and beat statistic that drive the controller
+double activity = 0;
+double beatVariability = 0;
+
+// The bulk lane only holds the <M> event from setupHeartRate() here,
+// and has room for all five announcements
+void setupSampleRates() {
+  for (int i = 0; i < NUMBER_OF_CHANNELS; i++) {
+    samplePeriods[i] = 0;
+    setSamplePeriod(i, delayTime);
+  }
+}
+
+void setSamplePeriod(int channel, unsigned long period) {
+  if (period < minSamplePeriods[channel]) {
+    period = minSamplePeriods[channel];
+  }
+  if (period > maxSamplePeriods[channel]) {
+    period = maxSamplePeriods[channel];
+  }
+  // The new period only takes effect once the host has been told about it,
+  // otherwise adaptSampleRates() asks again on the next frame
+  if (period != samplePeriods[channel] && printEventIfRoom('R', channel, period)) {
+    samplePeriods[channel] = period;
+  }
+}
+
+// Frames are sent as often as the fastest channel in them is sampled
+unsigned long getFramePeriod() {
+  int channels = NUMBER_OF_CHANNELS;
+  if (heartRateMode != HEART_RATE_VALUE) {
+    channels--;  // heart rate is not part of the frame
+  }
+  unsigned long period = samplePeriods[0];
+  for (int i = 1; i < channels; i++) {
+    if (samplePeriods[i] < period) {
+      period = samplePeriods[i];
+    }
+  }
+  return period;
+}
+
+boolean isSampleDue(int channel, unsigned long now) {
+  if (now - lastSampleTimes[channel] < samplePeriods[channel]) {
+    return false;
+  }
+  lastSampleTimes[channel] = now;
+  return true;
+}
+
+void updateActivity(double x, double y, double z) {
+  double deviation = fabs(sqrt(x * x + y * y + z * z) - 1.0);
+  activity += (deviation - activity) * 0.25;
+}
+
+// Root mean square of successive differences over the beat history
+void updateBeatVariability(unsigned long interval) {
+  volatile BeatBuffers & beats = heartRateArena.beats;
+  beats.intervals[beats.next] = interval;
+  beats.next = (beats.next + 1) % BEAT_HISTORY_SIZE;
+  if (beats.count < BEAT_HISTORY_SIZE) {
+    beats.count++;
+  }
+
+  int first = (beats.next + BEAT_HISTORY_SIZE - beats.count) % BEAT_HISTORY_SIZE;
+  double sum = 0;
+  for (int i = 1; i < beats.count; i++) {
+    long difference = (long)beats.intervals[(first + i) % BEAT_HISTORY_SIZE]
+                    - (long)beats.intervals[(first + i - 1) % BEAT_HISTORY_SIZE];
+    sum += (double)difference * difference;
+  }
+  beatVariability = beats.count > 1 ? sqrt(sum / (beats.count - 1)) : 0;
+}
+
+// Only the beat mode updates beatVariability, so it is cleared when the
+// heart rate mode changes instead of pinning the heart rate period
+void resetBeatVariability() {
+  beatVariability = 0;
+}
+
+// Called once per frame. Halves the period of channels that need more
+// detail and doubles it for channels that are idle, within the bounds.
+void adaptSampleRates() {
+  boolean active = activity > activeThreshold;
+  boolean resting = activity < restThreshold;
+  boolean heartRateChanging = beatVariability > variabilityThreshold;
+
+  for (int i = ACCEL_X_CHANNEL; i <= ACCEL_Z_CHANNEL; i++) {
+    if (active) {
+      setSamplePeriod(i, samplePeriods[i] / 2);
+    } else if (resting) {
+      setSamplePeriod(i, samplePeriods[i] * 2);
+    }
+  }
+
+  if (active || heartRateChanging) {
+    setSamplePeriod(HEART_RATE_CHANNEL, samplePeriods[HEART_RATE_CHANNEL] / 2);
+  } else if (resting) {
+    setSamplePeriod(HEART_RATE_CHANNEL, samplePeriods[HEART_RATE_CHANNEL] * 2);
+  }
+
+  // Skin temperature follows exercise, but slowly
+  if (active) {
+    setSamplePeriod(TEMPERATURE_CHANNEL, samplePeriods[TEMPERATURE_CHANNEL] / 2);
+  } else if (resting) {
+    setSamplePeriod(TEMPERATURE_CHANNEL, samplePeriods[TEMPERATURE_CHANNEL] * 2);
+  }
+}
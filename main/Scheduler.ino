@@ -0,0 +1,110 @@
+// Cooperative scheduler.
+//
+// Every task runs its job in steps: a step function does a small piece
+// of work and returns true while the job has more steps left. On every
+// pass of loop() the highest priority task with a pending job runs one
+// step. Since steps are never interrupted by other tasks, a released
+// high priority task waits at most one step of a lower priority task,
+// which is why every step is given a time budget. Steps that take longer
+// than their budget are counted as overruns, jobs that are still pending
+// when their next release is due as deadline misses.
+//
+// The budgets below bound that wait: no step of the lower priority tasks
+// may take more than 1 ms, and fall, serial and pulse steps stay within
+// 0.7, 0.3 and 0.5 ms. So a released fall job waits at most 1 ms, serial
+// 1 + 0.7 ms, and pulse 1 + 2 * 0.7 + 2 * 0.3 ms, all below their 2, 2
+// and 4 ms periods.
+struct Task {
+  boolean (*step)();
+  unsigned long period;        // ms between releases, 0 if released by another task
+  unsigned long budget;        // us a single step may take
+  unsigned long release;       // ms time the current job was released
+  unsigned long resume;        // ms time a suspended job may continue
+  boolean suspended;           // resume is only meaningful while set
+  boolean pending;
+  unsigned int overruns;
+  unsigned int deadlineMisses;
+};
+
+// In order of priority, highest first, indexed by the *_TASK defines
+Task tasks[NUMBER_OF_TASKS] = {
+  {fallTask,   2,                        700,  0, 0, false, false, 0, 0},
+  {serialTask, 2,                        300,  0, 0, false, false, 0, 0},
+  {pulseTask,  4,                        500,  0, 0, false, false, 0, 0},
+  {sensorTask, (unsigned long)delayTime, 1000, 0, 0, false, false, 0, 0},
+  {frameTask,  0,                        1000, 0, 0, false, false, 0, 0},
+  {lcdTask,    0,                        1000, 0, 0, false, false, 0, 0},
+  {buttonTask, 20,                       500,  0, 0, false, false, 0, 0},
+  {statsTask,  statsPeriod,              500,  0, 0, false, false, 0, 0},
+};
+
+void releaseTask(int task) {
+  if (tasks[task].pending) {
+    tasks[task].deadlineMisses++;
+  }
+  tasks[task].release = millis();
+  tasks[task].pending = true;
+}
+
+// Lets lower priority tasks run until the job can make progress again
+void suspendTask(int task, unsigned long ms) {
+  tasks[task].resume = millis() + ms;
+  tasks[task].suspended = true;
+}
+
+// Takes effect from the next release on
+void setTaskPeriod(int task, unsigned long period) {
+  tasks[task].period = period;
+}
+
+unsigned long getReleaseTime(int task) {
+  return tasks[task].release;
+}
+
+unsigned int getTaskOverruns(int task) {
+  return tasks[task].overruns;
+}
+
+unsigned int getTaskDeadlineMisses(int task) {
+  return tasks[task].deadlineMisses;
+}
+
+void runScheduler() {
+  unsigned long now = millis();
+
+  // Release periodic jobs on a fixed grid, unless we fell behind a whole period
+  for (int i = 0; i < NUMBER_OF_TASKS; i++) {
+    Task & task = tasks[i];
+    if (task.period == 0 || now - task.release < task.period) {
+      continue;
+    }
+    if (task.pending) {
+      task.deadlineMisses++;
+    }
+    task.release += task.period;
+    if (now - task.release >= task.period) {
+      task.release = now;
+    }
+    task.pending = true;
+  }
+
+  for (int i = 0; i < NUMBER_OF_TASKS; i++) {
+    Task & task = tasks[i];
+    if (!task.pending) {
+      continue;
+    }
+    if (task.suspended) {
+      // Compared while suspended only, so a stale resume can never hold it back
+      if ((long)(now - task.resume) < 0) {
+        continue;
+      }
+      task.suspended = false;
+    }
+    unsigned long start = micros();
+    task.pending = task.step();
+    if (micros() - start > task.budget) {
+      task.overruns++;
+    }
+    return;
+  }
+}
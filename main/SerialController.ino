@@ -1,17 +1,242 @@
-char startChar = '{';
-char separatorChar = ',';
-char endChar = '}';
-const int numberOfValues = 5;
+// The sample frame layout comes from Frame.h, shared with host decoders
+char startChar = frame::startChar;
+char separatorChar = frame::separatorChar;
+char endChar = frame::endChar;
+
+// Events are sent as <type,first,second>, next to the {...} sample frames
+char eventStartChar = '<';
+char eventEndChar = '>';
+const char hexDigits[] = "0123456789ABCDEF";
+
+// Output goes through two lanes. Frames are queued whole and the
+// serialTask() moves them to Serial; whenever it starts a new frame, a
+// waiting alert goes before any bulk frame. Serial's own buffer is kept
+// at most serialTxDepth bytes deep, so an alert never waits behind more
+// than that plus the rest of the frame being sent. The task runs every
+// 2 ms, in which 115200 baud sends ~23 bytes, so this keeps the link busy.
+#define ALERT_LANE 0
+#define BULK_LANE 1
+#define NUMBER_OF_LANES 2
+#define LANE_FRAMES 6
+
+const int serialTxDepth = 32;
+
+struct Lane {
+  char * buffer;
+  int size;
+  int head;                           // next byte to write
+  int tail;                           // next byte to send
+  int count;                          // bytes queued
+  int frameLengths[LANE_FRAMES];
+  unsigned long frameTimes[LANE_FRAMES]; // us when the frame was queued
+  byte firstFrame;
+  byte frames;
+  int remaining;                      // bytes left of the frame being sent
+  unsigned long sent;                 // frames sent
+  unsigned int drops;                 // frames that did not fit
+  int maxDepth;                       // most bytes ever queued
+  unsigned long maxLatency;           // most us a frame waited before its first byte was sent
+};
+
+// Room for two <F/J,ms,us> events of up to 25 bytes, fallTask() may queue both at once
+char alertBuffer[64];
+char bulkBuffer[128];
+Lane lanes[NUMBER_OF_LANES] = {
+  {alertBuffer, sizeof(alertBuffer)},
+  {bulkBuffer, sizeof(bulkBuffer)},
+};
 
 void setupSerialController() {
   Serial.begin(115200);  
 }
 
-void printDoubleArray(double values[]) {
-  Serial.print(startChar);
-  for(int i = 0; i < numberOfValues; i++) {
-    Serial.print(values[i]);
-    Serial.print(separatorChar);
+// True if a frame of length bytes fits the lane now, counts no drop
+boolean laneHasRoom(int laneIndex, int length) {
+  Lane & lane = lanes[laneIndex];
+  return lane.frames < LANE_FRAMES && lane.count + length <= lane.size;
+}
+
+boolean isLaneEmpty(int laneIndex) {
+  return lanes[laneIndex].frames == 0;
+}
+
+// Queues a whole frame or, if it does not fit, drops it
+boolean queueFrame(int laneIndex, const char * frame, int length) {
+  Lane & lane = lanes[laneIndex];
+  if (!laneHasRoom(laneIndex, length)) {
+    lane.drops++;
+    return false;
+  }
+
+  for (int i = 0; i < length; i++) {
+    lane.buffer[lane.head] = frame[i];
+    // Wrapped by hand, % on the runtime lane size is a software divide per byte
+    if (++lane.head == lane.size) {
+      lane.head = 0;
+    }
+  }
+  lane.count += length;
+  if (lane.count > lane.maxDepth) {
+    lane.maxDepth = lane.count;
+  }
+
+  byte slot = (lane.firstFrame + lane.frames) % LANE_FRAMES;
+  lane.frameLengths[slot] = length;
+  lane.frameTimes[slot] = micros();
+  lane.frames++;
+  return true;
+}
+
+// The lane to send from: the one in the middle of a frame, otherwise
+// the alert lane before the bulk lane. -1 when there is nothing to send.
+int nextLane() {
+  for (int i = 0; i < NUMBER_OF_LANES; i++) {
+    if (lanes[i].remaining > 0) {
+      return i;
+    }
+  }
+  for (int i = 0; i < NUMBER_OF_LANES; i++) {
+    if (lanes[i].frames > 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+boolean serialTask() {
+  while (Serial.availableForWrite() > SERIAL_TX_BUFFER_SIZE - 1 - serialTxDepth) {
+    int laneIndex = nextLane();
+    if (laneIndex < 0) {
+      break;
+    }
+
+    Lane & lane = lanes[laneIndex];
+    if (lane.remaining == 0) {
+      lane.remaining = lane.frameLengths[lane.firstFrame];
+      unsigned long latency = micros() - lane.frameTimes[lane.firstFrame];
+      if (latency > lane.maxLatency) {
+        lane.maxLatency = latency;
+      }
+      lane.firstFrame = (lane.firstFrame + 1) % LANE_FRAMES;
+      lane.frames--;
+      lane.sent++;
+    }
+
+    Serial.write(lane.buffer[lane.tail]);
+    if (++lane.tail == lane.size) {
+      lane.tail = 0;
+    }
+    lane.count--;
+    lane.remaining--;
+  }
+  return false;
+}
+
+unsigned long getLaneFramesSent(int lane) {
+  return lanes[lane].sent;
+}
+
+unsigned int getLaneDrops(int lane) {
+  return lanes[lane].drops;
+}
+
+int getLaneMaxDepth(int lane) {
+  return lanes[lane].maxDepth;
+}
+
+unsigned long getLaneMaxLatency(int lane) {
+  return lanes[lane].maxLatency;
+}
+
+// The sample frame being built by sendFrameStep(), its values in the
+// fixed point form Frame.h encodes
+double frameValues[NUMBER_OF_CHANNELS];
+long frameFixed[NUMBER_OF_CHANNELS];
+char frameBuffer[64];
+int frameCount = 0;
+int frameLength = 0;
+int frameStep = 0;
+
+// Builds one sample frame per job, encoding one value per step so a
+// frame never holds up the pulse sampling for long.
+boolean sendFrameStep() {
+  if (frameStep == 0) {
+    unsigned long frameTime;
+    readSnapshot(frameTime, frameValues);
+    // Without HEART_RATE_VALUE the heart rate is sent as events instead
+    frameCount = frame::valuesPerFrame<frame::SampleFrame>(heartRateMode == HEART_RATE_VALUE);
+    frameLength = frame::encodeStart<frame::SampleFrame>(frameBuffer, frameFixed, frameCount);
+  }
+
+  if (frameStep < frameCount) {
+    frameFixed[frameStep] = frame::toFixed(frameValues[frameStep], frame::SampleFrame::decimals(frameStep));
+    frameLength = frame::encodeField<frame::SampleFrame>(frameBuffer, frameFixed, frameCount, frameStep, frameLength);
+    frameStep++;
+    return true;
+  }
+
+  frameLength = frame::encodeEnd<frame::SampleFrame>(frameBuffer, frameFixed, frameCount, frameLength);
+  queueFrame(BULK_LANE, frameBuffer, frameLength);
+  if (reportI2cTimes) {
+    printEvent('I', getAccelReadMicros(), getTemperatureReadMicros());
+  }
+  frameStep = 0;
+  return false;
+}
+
+int formatEvent(char * text, char type, unsigned long first, unsigned long second) {
+  int length = 0;
+  text[length++] = eventStartChar;
+  text[length++] = type;
+  text[length++] = separatorChar;
+  ultoa(first, text + length, 10);
+  length += strlen(text + length);
+  text[length++] = separatorChar;
+  ultoa(second, text + length, 10);
+  length += strlen(text + length);
+  text[length++] = eventEndChar;
+  return length;
+}
+
+// Returns false when the bulk lane was full and the event was dropped
+boolean printEvent(char type, unsigned long first, unsigned long second) {
+  char text[32];
+  return queueFrame(BULK_LANE, text, formatEvent(text, type, first, second));
+}
+
+// Same as printEvent(), but leaves the event to the caller instead of
+// dropping it when the bulk lane is full, so retries are not counted
+boolean printEventIfRoom(char type, unsigned long first, unsigned long second) {
+  char text[32];
+  int length = formatEvent(text, type, first, second);
+  if (!laneHasRoom(BULK_LANE, length)) {
+    return false;
+  }
+  return queueFrame(BULK_LANE, text, length);
+}
+
+// Same as printEvent(), but goes ahead of every queued bulk frame
+void printUrgentEvent(char type, unsigned long first, unsigned long second) {
+  char text[32];
+  queueFrame(ALERT_LANE, text, formatEvent(text, type, first, second));
+}
+
+// Sends <P,firstIndex,samples> where every sample is a fixed number of
+// hex digits, so the host can split them without separators
+void printSampleBatch(unsigned long firstIndex, unsigned int samples[], int count, int digits) {
+  char text[96];
+  int length = 0;
+  text[length++] = eventStartChar;
+  text[length++] = 'P';
+  text[length++] = separatorChar;
+  ultoa(firstIndex, text + length, 10);
+  length += strlen(text + length);
+  text[length++] = separatorChar;
+  for(int i = 0; i < count; i++) {
+    for(int shift = (digits - 1) * 4; shift >= 0; shift -= 4) {
+      text[length++] = hexDigits[(samples[i] >> shift) & 0x0F];
+    }
   }
-  Serial.print(endChar);
+  text[length++] = eventEndChar;
+  queueFrame(BULK_LANE, text, length);
 }
@@ -0,0 +1,34 @@
+// Latest complete sample set, handed from the samplers to the outputs.
+//
+// This is a sequence lock: the writer makes the sequence odd while it
+// copies the values and even again when it is done. A reader copies the
+// values and retries when the sequence was odd or changed meanwhile.
+// The writer never waits and a reader never has to disable interrupts,
+// even when the writer runs from an interrupt. There must only be one
+// writer.
+volatile double snapshotValues[NUMBER_OF_CHANNELS];
+volatile unsigned long snapshotTime;
+volatile byte snapshotSequence = 0;
+
+void writeSnapshot(unsigned long time, double values[]) {
+  snapshotSequence++;
+  snapshotTime = time;
+  for (int i = 0; i < NUMBER_OF_CHANNELS; i++) {
+    snapshotValues[i] = values[i];
+  }
+  snapshotSequence++;
+}
+
+// Returns the sequence of the copied snapshot, so callers can tell
+// whether anything changed since their last read
+byte readSnapshot(unsigned long & time, double values[]) {
+  byte sequence;
+  do {
+    sequence = snapshotSequence;
+    time = snapshotTime;
+    for (int i = 0; i < NUMBER_OF_CHANNELS; i++) {
+      values[i] = snapshotValues[i];
+    }
+  } while ((sequence & 1) || sequence != snapshotSequence);
+  return sequence;
+}
@@ -0,0 +1,66 @@
+// Every statsPeriod ms the station dumps its counters as <S,metric,value>,
+// one metric per step. A metric is only queued while the bulk lane is
+// empty, so the dump holds at most one small event in it and never takes
+// the room a sample frame, beat event or PPG batch needs.
+//
+// Metrics:
+//   0, 1    frames sent on the alert and bulk lane
+//   2, 3    frames dropped on the alert and bulk lane
+//   4, 5    deepest queue in bytes on the alert and bulk lane
+//   6, 7    longest wait in us before the first byte of a frame, alert and bulk lane
+//   8       PPG batches dropped
+//   9       us of the last accelerometer read
+//   10      us of bus time of the last temperature read
+//   11      longest us from a fall interrupt to its event being queued
+//   20 + n  step overruns of task n (see the *_TASK defines)
+//   40 + n  deadline misses of task n
+#define TASK_OVERRUNS_METRIC 20
+#define TASK_DEADLINE_MISSES_METRIC 40
+#define NUMBER_OF_METRICS (TASK_DEADLINE_MISSES_METRIC + NUMBER_OF_TASKS)
+
+int statsMetric = 0;
+
+// Value of the metric, or -1 for ids that are not in use
+long getMetric(int metric) {
+  switch (metric) {
+    case 0: return getLaneFramesSent(ALERT_LANE);
+    case 1: return getLaneFramesSent(BULK_LANE);
+    case 2: return getLaneDrops(ALERT_LANE);
+    case 3: return getLaneDrops(BULK_LANE);
+    case 4: return getLaneMaxDepth(ALERT_LANE);
+    case 5: return getLaneMaxDepth(BULK_LANE);
+    case 6: return getLaneMaxLatency(ALERT_LANE);
+    case 7: return getLaneMaxLatency(BULK_LANE);
+    case 8: return getPpgOverruns();
+    case 9: return getAccelReadMicros();
+    case 10: return getTemperatureReadMicros();
+    case 11: return getMaxFallLatency();
+  }
+  if (metric >= TASK_OVERRUNS_METRIC && metric < TASK_OVERRUNS_METRIC + NUMBER_OF_TASKS) {
+    return getTaskOverruns(metric - TASK_OVERRUNS_METRIC);
+  }
+  if (metric >= TASK_DEADLINE_MISSES_METRIC && metric < TASK_DEADLINE_MISSES_METRIC + NUMBER_OF_TASKS) {
+    return getTaskDeadlineMisses(metric - TASK_DEADLINE_MISSES_METRIC);
+  }
+  return -1;
+}
+
+boolean statsTask() {
+  // Skip the unused ids in one go
+  while (statsMetric < NUMBER_OF_METRICS && getMetric(statsMetric) < 0) {
+    statsMetric++;
+  }
+  if (statsMetric == NUMBER_OF_METRICS) {
+    statsMetric = 0;
+    return false;
+  }
+
+  // Wait for the bulk data to drain first, then the event always fits
+  if (!isLaneEmpty(BULK_LANE)) {
+    suspendTask(STATS_TASK, 10);
+    return true;
+  }
+  printEvent('S', statsMetric, getMetric(statsMetric));
+  statsMetric++;
+  return true;
+}
@@ -15,10 +15,17 @@ TMP102 sensor0(0x48); // Initialize sensor at I2C address 0x48
 //  SDA - 0x4A
 //  SCL - 0x4B
 
+// The TMP102 supports fast mode I2C (up to 400 kHz)
+const unsigned long TEMPERATURE_I2C_CLOCK = 400000;
+
+// Bus time of the last wakeup/read/sleep sequence in microseconds
+unsigned long temperatureReadMicros = 0;
+
 
 void setupTemperature() {
   pinMode(ALERT_PIN,INPUT);  // Declare alertPin as an input
   sensor0.begin();  // Join I2C bus
+  resetI2cClock();
 
   // Initialize sensor0 settings
   // These settings are saved in the sensor, even if it loses power
@@ -49,24 +56,98 @@ void setupTemperature() {
   sensor0.setLowTempC(26.67); // set T_LOW in C
 }
 
-double getTemperature() {
-  float temperature;
-  boolean alertPinState, alertRegisterState;
-  
-  // Turn sensor on to start temperature measurement.
-  // Current consumtion typically ~10uA.
-  sensor0.wakeup();
+// A reading is done as a state machine, one I2C transaction per step,
+// so it can be spread over several scheduler steps
+#define TEMPERATURE_IDLE 0
+#define TEMPERATURE_WAKEUP 1
+#define TEMPERATURE_CONVERTING 2
+#define TEMPERATURE_FETCH 3
+#define TEMPERATURE_ALERT 4
+#define TEMPERATURE_SLEEP 5
 
-  // read temperature data
-  temperature = sensor0.readTempC();
+// A conversion takes 26 ms typically, 35 ms at most, after waking up
+const unsigned long TEMPERATURE_CONVERSION_TIME = 35;
 
-  // Check for Alert
-  alertPinState = digitalRead(ALERT_PIN); // read the Alert from pin
-  alertRegisterState = sensor0.alert();   // read the Alert from register
-  
-  // Place sensor in sleep mode to save power.
-  // Current consumtion typically <0.5uA.
-  sensor0.sleep();
-  
+int temperatureState = TEMPERATURE_IDLE;
+unsigned long temperatureWakeTime;
+float temperature = 0;
+boolean alertPinState, alertRegisterState;
+
+void startTemperature() {
+  if (temperatureState == TEMPERATURE_IDLE) {
+    temperatureState = TEMPERATURE_WAKEUP;
+    temperatureReadMicros = 0;
+  }
+}
+
+boolean isTemperatureBusy() {
+  return temperatureState != TEMPERATURE_IDLE;
+}
+
+// Milliseconds left before the conversion can be fetched
+unsigned long getTemperatureWait() {
+  unsigned long elapsed = millis() - temperatureWakeTime;
+  if (temperatureState != TEMPERATURE_CONVERTING || elapsed >= TEMPERATURE_CONVERSION_TIME) {
+    return 0;
+  }
+  return TEMPERATURE_CONVERSION_TIME - elapsed;
+}
+
+// Advances the reading by one step, returns true when a new
+// temperature is available through getTemperature()
+boolean stepTemperature() {
+  boolean done = false;
+  unsigned long start;
+
+  setI2cClock(TEMPERATURE_I2C_CLOCK);
+  start = micros();
+
+  switch (temperatureState) {
+    case TEMPERATURE_WAKEUP:
+      // Turn sensor on to start temperature measurement.
+      // Current consumtion typically ~10uA.
+      sensor0.wakeup();
+      temperatureWakeTime = millis();
+      temperatureState = TEMPERATURE_CONVERTING;
+      break;
+
+    case TEMPERATURE_CONVERTING:
+      if (getTemperatureWait() == 0) {
+        temperatureState = TEMPERATURE_FETCH;
+      }
+      break;
+
+    case TEMPERATURE_FETCH:
+      // read temperature data
+      temperature = sensor0.readTempC();
+      temperatureState = TEMPERATURE_ALERT;
+      break;
+
+    case TEMPERATURE_ALERT:
+      // Check for Alert
+      alertPinState = digitalRead(ALERT_PIN); // read the Alert from pin
+      alertRegisterState = sensor0.alert();   // read the Alert from register
+      temperatureState = TEMPERATURE_SLEEP;
+      break;
+
+    case TEMPERATURE_SLEEP:
+      // Place sensor in sleep mode to save power.
+      // Current consumtion typically <0.5uA.
+      sensor0.sleep();
+      temperatureState = TEMPERATURE_IDLE;
+      done = true;
+      break;
+  }
+
+  // Only the bus time, not the time spent waiting for the conversion
+  temperatureReadMicros += micros() - start;
+  return done;
+}
+
+double getTemperature() {
   return temperature;
 }
+
+unsigned long getTemperatureReadMicros() {
+  return temperatureReadMicros;
+}
@@ -1,17 +1,56 @@
+#include "Arena.h"
+#include "Frame.h"
+
+// Sampling period every channel starts at, adapted at runtime (SampleRate.ino)
 int delayTime = 500;
 
+// HEART_RATE_VALUE sends the raw pulse reading in every sample frame.
+// HEART_RATE_BEATS leaves it out and sends every detected beat once as
+// <B,beatTime,interBeatInterval>, both in milliseconds.
+// HEART_RATE_WAVEFORM streams the filtered and decimated pulse waveform
+// in batches of <P,firstSampleIndex,hexSamples>.
+#define HEART_RATE_VALUE 0
+#define HEART_RATE_BEATS 1
+#define HEART_RATE_WAVEFORM 2
+#define NUMBER_OF_HEART_RATE_MODES 3
+int heartRateMode = HEART_RATE_VALUE;  // change at runtime with setHeartRateMode(), announced as <M,...>
+
+// Channels in the order they appear in a sample frame, see Frame.h
+#define TEMPERATURE_CHANNEL frame::TEMPERATURE
+#define ACCEL_X_CHANNEL frame::ACCEL_X
+#define ACCEL_Y_CHANNEL frame::ACCEL_Y
+#define ACCEL_Z_CHANNEL frame::ACCEL_Z
+#define HEART_RATE_CHANNEL frame::HEART_RATE
+#define NUMBER_OF_CHANNELS frame::SampleFrame::channels
+
+// Tasks run by Scheduler.ino, in order of priority
+#define FALL_TASK 0
+#define SERIAL_TASK 1
+#define PULSE_TASK 2
+#define SENSOR_TASK 3
+#define FRAME_TASK 4
+#define LCD_TASK 5
+#define BUTTON_TASK 6
+#define STATS_TASK 7
+#define NUMBER_OF_TASKS 8
+
+// Send <I,accelReadMicros,temperatureReadMicros> after every sample frame
+boolean reportI2cTimes = false;
+// Dump the station counters as <S,metric,value> every statsPeriod ms (Stats.ino)
+const unsigned long statsPeriod = 10000;
+
 void setupAccelerometer();
 void setupButton();
 //void ButtonSetup();
 void setupHeartRate();
 void setupLcd();
+void setupSampleRates();
 void setupSerialController();
 void setupTemperature();
 void showHeartRate();
 void showAcceleration();
 void showTemperature();
 //void showMain();
-void LcdOnScreen();
 
 void setup() {
   setupAccelerometer();
@@ -20,20 +59,96 @@ void setup() {
   setupHeartRate();
   setupLcd();
   setupSerialController();
+  setupSampleRates();
   setupTemperature();
   //showMain();
 }
 
 void loop() {
-  
-  double accel[3];
-  getAcceleration(accel[0], accel[1], accel[2]);
-  double values[] = {getTemperature(), accel[0], accel[1], accel[2], getHeartRate()};
-  printDoubleArray(values);
-
-  LcdOnScreen(values[0], values[1], values[2], values[3], values[4]);
-  //showAcceleration(values[1], values[2], values[3]);
-  //showTemperature(values[0]);
-  //showHeartRate(values[4]);
-  delay(delayTime);
+  runScheduler();
+}
+
+// Beats are only a few tens of milliseconds wide, so the pulse sensor
+// is sampled every few milliseconds instead of once per frame
+boolean pulseTask() {
+  if (heartRateMode == HEART_RATE_BEATS && detectBeat()) {
+    printEvent('B', getBeatTime(), getBeatInterval());
+    addSample(HEART_RATE_CHANNEL, getBeatTime(), getBeatsPerMinute());
+    updateBeatVariability(getBeatInterval());
+  }
+  if (heartRateMode == HEART_RATE_WAVEFORM) {
+    sendPpgBatch();
+  }
+  return false;
+}
+
+boolean sensorsStarted = false;
+
+// Steps the sensor drivers, one I2C transaction per step, then publishes
+// the frame for the outputs. Every reading is timestamped right after it
+// was taken.
+boolean sensorTask() {
+  unsigned long frameTime = getReleaseTime(SENSOR_TASK);
+
+  if (!sensorsStarted) {
+    if (isSampleDue(ACCEL_X_CHANNEL, frameTime)) {
+      startAcceleration();
+    }
+    if (isSampleDue(TEMPERATURE_CHANNEL, frameTime)) {
+      startTemperature();
+    }
+    sensorsStarted = true;
+  }
+
+  if (isAccelerationBusy()) {
+    if (stepAcceleration()) {
+      double x, y, z;
+      getAcceleration(x, y, z);
+      unsigned long time = millis();
+      addSample(ACCEL_X_CHANNEL, time, x);
+      addSample(ACCEL_Y_CHANNEL, time, y);
+      addSample(ACCEL_Z_CHANNEL, time, z);
+      updateActivity(x, y, z);
+    }
+    return true;
+  }
+
+  if (isTemperatureBusy()) {
+    if (stepTemperature()) {
+      addSample(TEMPERATURE_CHANNEL, millis(), getTemperature());
+    } else {
+      // Let the outputs run while the TMP102 is converting
+      suspendTask(SENSOR_TASK, getTemperatureWait());
+    }
+    return true;
+  }
+
+  if (heartRateMode == HEART_RATE_WAVEFORM) {
+    addSample(HEART_RATE_CHANNEL, millis(), getPpgSample());
+  } else if (heartRateMode == HEART_RATE_VALUE && isSampleDue(HEART_RATE_CHANNEL, frameTime)) {
+    double heartRate = getHeartRate();
+    addSample(HEART_RATE_CHANNEL, millis(), heartRate);
+  }
+
+  double values[NUMBER_OF_CHANNELS];
+  for (int i = 0; i < NUMBER_OF_CHANNELS; i++) {
+    values[i] = resample(i, frameTime);
+  }
+  writeSnapshot(frameTime, values);
+  adaptSampleRates();
+  setTaskPeriod(SENSOR_TASK, getFramePeriod());
+
+  releaseTask(FRAME_TASK);
+  releaseTask(LCD_TASK);
+  sensorsStarted = false;
+  return false;
+}
+
+boolean frameTask() {
+  return sendFrameStep();
+}
+
+// The view is picked with the buttons, see showButtonView()
+boolean lcdTask() {
+  return updateLcdStep();
 }